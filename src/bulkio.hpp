@@ -0,0 +1,292 @@
+/** ================================================================
+| bulkio.hpp  --  src/bulkio.hpp
+|
+| Created by Jack on 10/18, 2026
+| Copyright © 2024 jacktogon. All rights reserved.
+================================================================= */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+/** How file bodies are read and written. */
+struct IoOptions {
+    bool     bulk              = false; // keep our data out of the page cache
+    uint64_t maxBytesPerSecond = 0;     // cap on bytes read + written, 0 = unlimited
+};
+
+
+/**
+ * Process-wide token bucket for the I/O bandwidth cap.
+ * @note Callers sleep for their own bytes, so the long-run rate is exact and
+ *       bursts never exceed one buffer.
+ */
+class RateLimiter {
+public:
+    static RateLimiter& instance() {
+        static RateLimiter limiter;
+        return limiter;
+    }
+
+    void setRate(uint64_t bytesPerSecond) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rate     = bytesPerSecond;
+        nextFree = std::chrono::steady_clock::now();
+    }
+
+    void consume(uint64_t bytes) {
+        std::chrono::steady_clock::time_point wakeUp;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (rate == 0) return;
+            auto now = std::chrono::steady_clock::now();
+            if (nextFree < now) nextFree = now;
+            nextFree += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(static_cast<double>(bytes) / rate));
+            wakeUp = nextFree;
+        }
+        std::this_thread::sleep_until(wakeUp);
+    }
+
+private:
+    std::mutex                            mutex;
+    uint64_t                              rate = 0;
+    std::chrono::steady_clock::time_point nextFree;
+};
+
+
+#ifndef _WIN32
+/**
+ * File stream buffer for bulk runs that keeps its data out of the page cache.
+ *
+ * Reads and writes go through `pread` / `pwrite` on its own 1 MiB buffer so
+ * the right descriptor gets the hints:
+ *   - Linux: `POSIX_FADV_SEQUENTIAL` on open; consumed input windows are
+ *     dropped with `POSIX_FADV_DONTNEED`; each written window starts
+ *     writeback with `sync_file_range`, and the previous one is waited for
+ *     and dropped, so dirty pages never pile up.
+ *   - macOS: `F_NOCACHE`, the kernel does not keep our pages at all.
+ * Every transfer is also charged to the `RateLimiter`.
+ *
+ * A buffer is either read-only or write-only.
+ * @note Dropping pages is per file, so pages of an input that were already
+ *       cached before the run are evicted as well.
+ */
+class BulkFileBuf : public std::streambuf {
+public:
+    static const size_t BUFFER_SIZE = 1024 * 1024;
+
+    BulkFileBuf(const std::filesystem::path& path, std::ios::openmode mode, bool bulkMode)
+        : writing(mode & std::ios::out), bulk(bulkMode), buffer(BUFFER_SIZE) {
+        fd = writing ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)
+                     : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+
+        if (bulk) {
+#if defined(__linux__)
+            if (!writing) ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#elif defined(__APPLE__)
+            ::fcntl(fd, F_NOCACHE, 1);
+#endif
+        }
+        if (writing) setp(buffer.data(), buffer.data() + buffer.size());
+        else         setg(buffer.data(), buffer.data(), buffer.data());
+    }
+
+    ~BulkFileBuf() override { close(); }
+
+    bool is_open() const { return fd >= 0; }
+
+    /** Flush, wait for writeback and drop the whole file from the cache. */
+    bool close() {
+        if (fd < 0) return true;
+        bool ok = !writing || flushBuffer();
+        if (bulk) {
+            if (writing) ok = ::fdatasync(fd) == 0 && ok;
+#if defined(__linux__)
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+        }
+        ok = ::close(fd) == 0 && ok;
+        fd = -1;
+        return ok;
+    }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+        uint64_t consumed = static_cast<uint64_t>(egptr() - eback());
+        dropWindow(bufferOffset, consumed);
+        bufferOffset += consumed;
+
+        ssize_t n = 0;
+        do {
+            n = ::pread(fd, buffer.data(), buffer.size(), static_cast<off_t>(bufferOffset));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            setg(buffer.data(), buffer.data(), buffer.data());
+            return traits_type::eof();
+        }
+
+        RateLimiter::instance().consume(static_cast<uint64_t>(n));
+        setg(buffer.data(), buffer.data(), buffer.data() + n);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    int_type overflow(int_type ch) override {
+        if (!writing || !flushBuffer()) return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        return (!writing || flushBuffer()) ? 0 : -1;
+    }
+
+    pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode) override {
+        uint64_t base = 0;
+        if (dir == std::ios::cur) {
+            base = writing ? bufferOffset + (pptr() - pbase()) : bufferOffset + (gptr() - eback());
+        } else if (dir == std::ios::end) {
+            if (writing && !flushBuffer()) return pos_type(off_type(-1));
+            struct stat st;
+            if (::fstat(fd, &st) != 0) return pos_type(off_type(-1));
+            base = static_cast<uint64_t>(st.st_size);
+        }
+        if (off < 0 && static_cast<uint64_t>(-off) > base) return pos_type(off_type(-1));
+        return seekTo(base + off);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios::openmode) override {
+        if (off_type(pos) < 0) return pos_type(off_type(-1));
+        return seekTo(static_cast<uint64_t>(off_type(pos)));
+    }
+
+private:
+    pos_type seekTo(uint64_t target) {
+        if (writing) {
+            if (!flushBuffer()) return pos_type(off_type(-1));
+            bufferOffset = target;
+        } else if (target >= bufferOffset && target <= bufferOffset + (egptr() - eback())) {
+            setg(eback(), eback() + (target - bufferOffset), egptr()); // still buffered
+        } else {
+            bufferOffset = target;
+            setg(buffer.data(), buffer.data(), buffer.data());
+        }
+        return pos_type(off_type(target));
+    }
+
+    bool flushBuffer() {
+        size_t length = static_cast<size_t>(pptr() - pbase());
+        size_t done   = 0;
+        while (done < length) {
+            ssize_t n = ::pwrite(fd, pbase() + done, length - done, static_cast<off_t>(bufferOffset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        if (length > 0) {
+            RateLimiter::instance().consume(length);
+            writeBack(bufferOffset, length);
+        }
+        bufferOffset += length;
+        setp(buffer.data(), buffer.data() + buffer.size());
+        return true;
+    }
+
+    /** Input window fully consumed, nobody needs its pages any more. */
+    void dropWindow(uint64_t offset, uint64_t length) {
+#if defined(__linux__)
+        if (bulk && length > 0) ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#else
+        (void)offset; (void)length;
+#endif
+    }
+
+    /**
+     * Kick off writeback of the window just written, then wait for the one
+     * before it and drop it. Keeps at most two windows of dirty pages.
+     */
+    void writeBack(uint64_t offset, uint64_t length) {
+#if defined(__linux__)
+        if (!bulk) return;
+        ::sync_file_range(fd, static_cast<off_t>(offset), static_cast<off_t>(length), SYNC_FILE_RANGE_WRITE);
+        if (pendingLength > 0) {
+            ::sync_file_range(fd, static_cast<off_t>(pendingOffset), static_cast<off_t>(pendingLength),
+                              SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            ::posix_fadvise(fd, static_cast<off_t>(pendingOffset), static_cast<off_t>(pendingLength), POSIX_FADV_DONTNEED);
+        }
+        pendingOffset = offset;
+        pendingLength = length;
+#else
+        (void)offset; (void)length;
+#endif
+    }
+
+    int               fd = -1;
+    bool              writing;
+    bool              bulk;
+    std::vector<char> buffer;
+    uint64_t          bufferOffset  = 0; // file offset of buffer[0]
+    uint64_t          pendingOffset = 0; // last written window, not yet dropped
+    uint64_t          pendingLength = 0;
+};
+#endif
+
+
+/**
+ * Open `path` for binary reading (`std::ios::in`) or writing
+ * (`std::ios::out`, truncating). Plain `std::filebuf` unless `io` asks for
+ * bulk mode or a bandwidth cap.
+ * @returns `nullptr` if the file cannot be opened.
+ */
+std::unique_ptr<std::streambuf> openFileBuf(const std::filesystem::path& path, std::ios::openmode mode, const IoOptions& io) {
+#ifndef _WIN32
+    if (io.bulk || io.maxBytesPerSecond > 0) {
+        auto buf = std::make_unique<BulkFileBuf>(path, mode, io.bulk);
+        if (!buf->is_open()) return nullptr;
+        return buf;
+    }
+#else
+    (void)io; // no bulk mode on Windows yet
+#endif
+    std::ios::openmode fileMode = mode | std::ios::binary;
+    if (mode & std::ios::out) fileMode |= std::ios::trunc;
+
+    auto buf = std::make_unique<std::filebuf>();
+    if (!buf->open(path, fileMode)) return nullptr;
+    return buf;
+}
+
+/**
+ * Flush and close a buffer from `openFileBuf()`.
+ * @returns `false` if pending data could not be written.
+ */
+bool closeFileBuf(std::unique_ptr<std::streambuf>& buf) {
+    bool ok = true;
+#ifndef _WIN32
+    if (auto* bulkBuf = dynamic_cast<BulkFileBuf*>(buf.get())) ok = bulkBuf->close();
+#endif
+    if (auto* fileBuf = dynamic_cast<std::filebuf*>(buf.get())) ok = fileBuf->close() != nullptr;
+    buf.reset();
+    return ok;
+}
@@ -0,0 +1,318 @@
+/** ================================================================
+| cipher.hpp  --  src/cipher.hpp
+|
+| Created by Jack on 10/18, 2026
+| Copyright © 2024 jacktogon. All rights reserved.
+================================================================= */
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+
+#include "sparse.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+const int NONCE_SIZE = 12, // 96bits, the native AEAD nonce size
+          TAG_SIZE   = 16;
+
+/** Bytes handed to OpenSSL per EVP update call. */
+const size_t CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Cipher identifier recorded in the `.knot` header.
+ * @note The values are part of the on-disk format, never renumber them.
+ */
+enum class CipherId : uint8_t {
+    AES_256_GCM       = 1,
+    CHACHA20_POLY1305 = 2,
+};
+
+/*
+ * Cipher backends. Each backend is a policy type exposing its header id, its
+ * config name and the OpenSSL EVP cipher; the streaming loops below are
+ * templated on it, so the backend is picked once per file rather than once
+ * per chunk.
+ */
+struct Aes256Gcm {
+    static constexpr CipherId    ID   = CipherId::AES_256_GCM;
+    static constexpr const char* NAME = "aes-256-gcm";
+    static const EVP_CIPHER* evp() { return EVP_aes_256_gcm(); }
+};
+
+struct ChaCha20Poly1305 {
+    static constexpr CipherId    ID   = CipherId::CHACHA20_POLY1305;
+    static constexpr const char* NAME = "chacha20-poly1305";
+    static const EVP_CIPHER* evp() { return EVP_chacha20_poly1305(); }
+};
+
+
+/**
+ * Check whether the CPU has hardware AES (AES-NI + PCLMULQDQ on x86, the
+ * crypto extension on ARMv8).
+ * @note Unknown architectures report `false` so they fall back to ChaCha20.
+ */
+bool hasHardwareAes() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    return (ecx & bit_AES) && (ecx & bit_PCLMUL);
+#elif defined(_M_X64) || defined(_M_IX86)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 25)) && (info[2] & (1 << 1));
+#elif defined(__aarch64__) && defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    return true; // Apple Silicon & Windows on ARM always ship the crypto extension
+#else
+    return false;
+#endif
+}
+
+/** Pick the fastest cipher for this host. */
+CipherId detectCipher() {
+    return hasHardwareAes() ? CipherId::AES_256_GCM : CipherId::CHACHA20_POLY1305;
+}
+
+std::string cipherName(CipherId id) {
+    switch (id) {
+        case CipherId::AES_256_GCM:       return Aes256Gcm::NAME;
+        case CipherId::CHACHA20_POLY1305: return ChaCha20Poly1305::NAME;
+    }
+    throw std::runtime_error("Unknown cipher id: " + std::to_string(static_cast<int>(id)));
+}
+
+/**
+ * Map a `config.json` cipher name to its id. `"auto"` (or an empty string)
+ * selects via `detectCipher()`.
+ */
+CipherId parseCipherName(const std::string& name) {
+    if (name.empty() || name == "auto")  return detectCipher();
+    if (name == Aes256Gcm::NAME)         return CipherId::AES_256_GCM;
+    if (name == ChaCha20Poly1305::NAME)  return CipherId::CHACHA20_POLY1305;
+    throw std::runtime_error("Unknown cipher in config: " + name);
+}
+
+/** Validate a cipher id read back from a file header. */
+CipherId toCipherId(uint8_t value) {
+    switch (static_cast<CipherId>(value)) {
+        case CipherId::AES_256_GCM:
+        case CipherId::CHACHA20_POLY1305: return static_cast<CipherId>(value);
+    }
+    throw std::runtime_error("Unsupported cipher id in header: " + std::to_string(value));
+}
+
+
+using CipherCtx = std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)>;
+using AuthTag   = std::array<uint8_t, TAG_SIZE>;
+
+/** Create an AEAD context keyed with `key` / `nonce` and fed with `aad`. */
+template <typename Cipher>
+CipherCtx initCipherCtx(bool encrypt,
+                        const std::vector<uint8_t>& key,
+                        const std::vector<uint8_t>& nonce,
+                        const std::vector<uint8_t>& aad) {
+    CipherCtx ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    if (!ctx) throw std::runtime_error("Unable to allocate cipher context");
+
+    int len = 0;
+    if (EVP_CipherInit_ex(ctx.get(), Cipher::evp(), nullptr, nullptr, nullptr, encrypt) != 1
+        || EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_AEAD_SET_IVLEN, NONCE_SIZE, nullptr) != 1
+        || EVP_CipherInit_ex(ctx.get(), nullptr, nullptr, key.data(), nonce.data(), encrypt) != 1
+        || (!aad.empty() && EVP_CipherUpdate(ctx.get(), nullptr, &len, aad.data(), static_cast<int>(aad.size())) != 1)
+    ) {
+        throw std::runtime_error(std::string("Unable to initialize ") + Cipher::NAME);
+    }
+    return ctx;
+}
+
+/**
+ * Encrypt the `extents` of `in` into `out` as one contiguous ciphertext.
+ * @returns the authentication tag, to be stored alongside the ciphertext.
+ */
+template <typename Cipher>
+AuthTag encryptStream(std::istream& in, std::ostream& out, const Extents& extents,
+                      const std::vector<uint8_t>& key,
+                      const std::vector<uint8_t>& nonce,
+                      const std::vector<uint8_t>& aad) {
+    CipherCtx ctx = initCipherCtx<Cipher>(true, key, nonce, aad);
+
+    std::vector<uint8_t> inBuf(CHUNK_SIZE), outBuf(CHUNK_SIZE + EVP_MAX_BLOCK_LENGTH);
+    int outLen = 0;
+    for (const auto& extent : extents) {
+        in.seekg(extent.offset);
+        for (uint64_t left = extent.length; left > 0; ) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(left, inBuf.size()));
+            if (!in.read(reinterpret_cast<char*>(inBuf.data()), want))
+                throw std::runtime_error("Plaintext ended early (file changed while encrypting?)");
+            if (EVP_EncryptUpdate(ctx.get(), outBuf.data(), &outLen, inBuf.data(), static_cast<int>(want)) != 1)
+                throw std::runtime_error(std::string(Cipher::NAME) + " encryption failed");
+            out.write(reinterpret_cast<char*>(outBuf.data()), outLen);
+            left -= want;
+        }
+    }
+
+    if (EVP_EncryptFinal_ex(ctx.get(), outBuf.data(), &outLen) != 1)
+        throw std::runtime_error(std::string(Cipher::NAME) + " finalization failed");
+    out.write(reinterpret_cast<char*>(outBuf.data()), outLen);
+
+    AuthTag tag;
+    if (EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_AEAD_GET_TAG, TAG_SIZE, tag.data()) != 1)
+        throw std::runtime_error("Unable to read authentication tag");
+    return tag;
+}
+
+/**
+ * Decrypt the contiguous ciphertext in `in`, scattering it over the `extents`
+ * of `out`, and verify it against `tag`. Gaps between extents are never
+ * written, so they stay holes.
+ * @note Throws on a tag mismatch; whatever was already written to `out` must
+ *       then be discarded by the caller.
+ */
+template <typename Cipher>
+void decryptStream(std::istream& in, std::ostream& out, const Extents& extents,
+                   const std::vector<uint8_t>& key,
+                   const std::vector<uint8_t>& nonce,
+                   const std::vector<uint8_t>& aad,
+                   AuthTag tag) {
+    CipherCtx ctx = initCipherCtx<Cipher>(false, key, nonce, aad);
+
+    std::vector<uint8_t> inBuf(CHUNK_SIZE), outBuf(CHUNK_SIZE + EVP_MAX_BLOCK_LENGTH);
+    int outLen = 0;
+    for (const auto& extent : extents) {
+        out.seekp(extent.offset);
+        for (uint64_t left = extent.length; left > 0; ) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(left, inBuf.size()));
+            if (!in.read(reinterpret_cast<char*>(inBuf.data()), want))
+                throw std::runtime_error("Unexpected end of ciphertext");
+            if (EVP_DecryptUpdate(ctx.get(), outBuf.data(), &outLen, inBuf.data(), static_cast<int>(want)) != 1)
+                throw std::runtime_error(std::string(Cipher::NAME) + " decryption failed");
+            out.write(reinterpret_cast<char*>(outBuf.data()), outLen);
+            left -= want;
+        }
+    }
+
+    if (EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_AEAD_SET_TAG, TAG_SIZE, tag.data()) != 1)
+        throw std::runtime_error("Unable to set authentication tag");
+    if (EVP_DecryptFinal_ex(ctx.get(), outBuf.data(), &outLen) != 1)
+        throw std::runtime_error("Authentication failed (wrong password or corrupted file)");
+    out.write(reinterpret_cast<char*>(outBuf.data()), outLen);
+}
+
+
+/**
+ * Encrypt a small in-memory buffer (a data key) in one call.
+ * @returns the authentication tag; the ciphertext is as long as `plaintext`.
+ */
+template <typename Cipher>
+AuthTag sealBytes(const std::vector<uint8_t>& plaintext, std::vector<uint8_t>& ciphertext,
+                  const std::vector<uint8_t>& key,
+                  const std::vector<uint8_t>& nonce,
+                  const std::vector<uint8_t>& aad) {
+    CipherCtx ctx = initCipherCtx<Cipher>(true, key, nonce, aad);
+
+    ciphertext.resize(plaintext.size() + EVP_MAX_BLOCK_LENGTH);
+    int len = 0, finalLen = 0;
+    if (EVP_EncryptUpdate(ctx.get(), ciphertext.data(), &len, plaintext.data(), static_cast<int>(plaintext.size())) != 1
+        || EVP_EncryptFinal_ex(ctx.get(), ciphertext.data() + len, &finalLen) != 1)
+        throw std::runtime_error(std::string(Cipher::NAME) + " encryption failed");
+    ciphertext.resize(len + finalLen);
+
+    AuthTag tag;
+    if (EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_AEAD_GET_TAG, TAG_SIZE, tag.data()) != 1)
+        throw std::runtime_error("Unable to read authentication tag");
+    return tag;
+}
+
+/**
+ * Decrypt and verify a buffer sealed by `sealBytes()`.
+ * @note Throws on a tag mismatch; nothing unauthenticated is returned.
+ */
+template <typename Cipher>
+std::vector<uint8_t> openBytes(const std::vector<uint8_t>& ciphertext,
+                               const std::vector<uint8_t>& key,
+                               const std::vector<uint8_t>& nonce,
+                               const std::vector<uint8_t>& aad,
+                               AuthTag tag) {
+    CipherCtx ctx = initCipherCtx<Cipher>(false, key, nonce, aad);
+
+    std::vector<uint8_t> plaintext(ciphertext.size() + EVP_MAX_BLOCK_LENGTH);
+    int len = 0, finalLen = 0;
+    bool ok = EVP_DecryptUpdate(ctx.get(), plaintext.data(), &len, ciphertext.data(), static_cast<int>(ciphertext.size())) == 1
+           && EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_AEAD_SET_TAG, TAG_SIZE, tag.data()) == 1
+           && EVP_DecryptFinal_ex(ctx.get(), plaintext.data() + len, &finalLen) == 1;
+    if (!ok) {
+        OPENSSL_cleanse(plaintext.data(), plaintext.size());
+        throw std::runtime_error("Authentication failed (wrong password or corrupted file)");
+    }
+    plaintext.resize(len + finalLen);
+    return plaintext;
+}
+
+
+/*
+ * Runtime dispatch: one switch per file, then straight into the
+ * instantiation for the chosen backend.
+ */
+AuthTag encryptStream(CipherId id, std::istream& in, std::ostream& out, const Extents& extents,
+                      const std::vector<uint8_t>& key,
+                      const std::vector<uint8_t>& nonce,
+                      const std::vector<uint8_t>& aad) {
+    switch (id) {
+        case CipherId::AES_256_GCM:       return encryptStream<Aes256Gcm>(in, out, extents, key, nonce, aad);
+        case CipherId::CHACHA20_POLY1305: return encryptStream<ChaCha20Poly1305>(in, out, extents, key, nonce, aad);
+    }
+    throw std::runtime_error("Unknown cipher id: " + std::to_string(static_cast<int>(id)));
+}
+
+void decryptStream(CipherId id, std::istream& in, std::ostream& out, const Extents& extents,
+                   const std::vector<uint8_t>& key,
+                   const std::vector<uint8_t>& nonce,
+                   const std::vector<uint8_t>& aad,
+                   const AuthTag& tag) {
+    switch (id) {
+        case CipherId::AES_256_GCM:       return decryptStream<Aes256Gcm>(in, out, extents, key, nonce, aad, tag);
+        case CipherId::CHACHA20_POLY1305: return decryptStream<ChaCha20Poly1305>(in, out, extents, key, nonce, aad, tag);
+    }
+    throw std::runtime_error("Unknown cipher id: " + std::to_string(static_cast<int>(id)));
+}
+
+AuthTag sealBytes(CipherId id, const std::vector<uint8_t>& plaintext, std::vector<uint8_t>& ciphertext,
+                  const std::vector<uint8_t>& key,
+                  const std::vector<uint8_t>& nonce,
+                  const std::vector<uint8_t>& aad) {
+    switch (id) {
+        case CipherId::AES_256_GCM:       return sealBytes<Aes256Gcm>(plaintext, ciphertext, key, nonce, aad);
+        case CipherId::CHACHA20_POLY1305: return sealBytes<ChaCha20Poly1305>(plaintext, ciphertext, key, nonce, aad);
+    }
+    throw std::runtime_error("Unknown cipher id: " + std::to_string(static_cast<int>(id)));
+}
+
+std::vector<uint8_t> openBytes(CipherId id, const std::vector<uint8_t>& ciphertext,
+                               const std::vector<uint8_t>& key,
+                               const std::vector<uint8_t>& nonce,
+                               const std::vector<uint8_t>& aad,
+                               const AuthTag& tag) {
+    switch (id) {
+        case CipherId::AES_256_GCM:       return openBytes<Aes256Gcm>(ciphertext, key, nonce, aad, tag);
+        case CipherId::CHACHA20_POLY1305: return openBytes<ChaCha20Poly1305>(ciphertext, key, nonce, aad, tag);
+    }
+    throw std::runtime_error("Unknown cipher id: " + std::to_string(static_cast<int>(id)));
+}
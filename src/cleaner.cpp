@@ -8,19 +8,24 @@
 
 int main() {
     try {
+        if (std::filesystem::exists("config.json")) {
+            configureLogger(parseConfigFile("config.json"));
+        }
+
         std::vector<std::string> knotFiles = findKnotFiles();
         
-        std::cout << "Found the following .knot files:" << std::endl;
+        logInfo("Found the following .knot files:");
         for (const auto& file : knotFiles) {
-            std::cout << file << std::endl;
+            logInfo(file);
         }
         
         if (knotFiles.empty()) {
-            std::cout << "No .knot files found." << std::endl;
+            logInfo("No .knot files found.");
             return 0;
         }
 
         std::string confirmation;
+        Logger::instance().flush();
         std::cout << "Are you sure you want to remove these files? (yes/no): ";
         std::cin >> confirmation;
         toLower(confirmation);
@@ -31,15 +36,15 @@ int main() {
                 try {
                     removeKnotFile(file);
                 } catch (const std::exception& e) {
-                    std::cerr << "Error removing " << file << ": " << e.what() << std::endl;
+                    logError("Error removing ", file, ": ", e.what());
                 }
             }
-            std::cout << "Removal process completed." << std::endl;
+            logInfo("Removal process completed.");
         } else {
-            std::cout << "Operation cancelled." << std::endl;
+            logInfo("Operation cancelled.");
         }
     } catch (const std::exception& e) {
-        std::cerr << "An error occurred: " << e.what() << std::endl;
+        logError("An error occurred: ", e.what());
         return 1;
     }
     
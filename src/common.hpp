@@ -20,6 +20,7 @@
 #include <functional>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
+#include <openssl/rand.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -34,10 +35,11 @@
 namespace fs = std::filesystem;
 
 #include "JsonParser.hpp"
-
-const int SALT_SIZE = 16, 
-          KEY_SIZE  = 32, // 256bits
-          IV_SIZE   = 16;
+#include "logger.hpp"
+#include "keys.hpp"
+#include "cipher.hpp"
+#include "journal.hpp"
+#include "bulkio.hpp"
 
 /**
  * Transform `std::string` to lowercase.
@@ -64,14 +66,15 @@ void strip(std::string& str) {
 }
 
 
-std::string getPassword() {
+std::string getPassword(const std::string& prompt = "Enter password: ") {
     const char BACKSPACE = 8;
     const char RETURN    = 13;
 
     std::string password;
     int ch = 0;
 
-    std::cout << "Enter password: ";
+    Logger::instance().flush(); // don't let queued log lines land in the prompt
+    std::cout << prompt;
 
 #ifdef _WIN32
     while ((ch = _getch()) != RETURN) {
@@ -124,22 +127,6 @@ bool matchesWildcard(const std::string& text, const std::string& pattern) {
 }
 
 
-/** 
- * Generates a vector of random (0 ~ 255) bytes.
- * @note Uses hardware random device as seed for Mersenne Twister
- * @example
- * auto ten_random_bytes = generateRandomBytes(10);
- */
-std::vector<uint8_t> generateRandomBytes(size_t size) {
-    std::vector<uint8_t> bytes(size);
-    std::random_device   rd;                     // hardware rand-num generator src
-    std::mt19937         gen(rd());              // mt pseudorandom generator
-    std::uniform_int_distribution<> dis(0, 255); // get uniform random numbers (0 ~ 255)
-    std::generate(bytes.begin(), bytes.end(), [&]() { return static_cast<uint8_t>(dis(gen)); });
-    return bytes;
-}
-
-
 /**
  * Derive a key from combining `password` and `salt`
  * @deprecated Use SHA256
@@ -156,28 +143,123 @@ std::vector<uint8_t> deriveKey_d(const std::string& password, const std::vector<
     key.resize(KEY_SIZE); // Truncate key to size of KEY_SIZE bytes
     return key;
 }
-/** Derive a key from combining `password` and `salt` with SHA256 */
-std::vector<uint8_t> deriveKey(const std::string& password, const std::vector<uint8_t>& salt) {
-    std::vector<uint8_t> key(KEY_SIZE);
-    if (PKCS5_PBKDF2_HMAC(
-            password.c_str(), 
-            password.length(),
-            salt.data(),      
-            salt.size(),
-            10000,        // 10000 iterations
-            EVP_sha256(),
-            KEY_SIZE,
-            key.data()
-        ) != 1
-    ) {
-        throw std::runtime_error("PBKDF2 key derivation failed");
+
+
+/** Signature of the current (AEAD) format. */
+const std::array<char, 8> KNOT_SIGNATURE        = {'K', 'N', 'O', 'T', 'E', 'N', 'C', '2'};
+/** Signature of the original XOR format, still accepted by the decrypter. */
+const std::array<char, 8> KNOT_LEGACY_SIGNATURE = {'K', 'N', 'O', 'T', 'E', 'N', 'C', '1'};
+
+
+/**
+ * Fixed-size header at the start of every `.knot` file.
+ *
+ *   signature    8 bytes   KNOT_SIGNATURE      \
+ *   cipher       1 byte    CipherId             | prefix, never rewritten
+ *   nonce        12 bytes  body AEAD nonce     /
+ *   salt         16 bytes  PBKDF2 salt         \
+ *   wrap nonce   12 bytes  key-wrap nonce       | key block, rewritten by rekey
+ *   wrapped key  32 bytes  encrypted data key   |
+ *   wrap tag     16 bytes  key-wrap tag        /
+ *
+ * The body is encrypted with a random per-file data key; the key block holds
+ * that key sealed under `deriveKey(password, salt)`. Changing the password
+ * therefore only rewrites the key block. The header is followed by the
+ * extent map (see sparse.hpp), the ciphertext of the data extents only, then
+ * a TAG_SIZE authentication tag. The prefix is fed to both seals as
+ * associated data, so the recorded cipher cannot be swapped; the body seal
+ * also covers the extent map.
+ */
+struct KnotHeader {
+    CipherId             cipher = CipherId::AES_256_GCM;
+    std::vector<uint8_t> nonce;
+    std::vector<uint8_t> salt;
+    std::vector<uint8_t> wrapNonce;
+    std::vector<uint8_t> wrappedKey;
+    AuthTag              wrapTag{};
+};
+
+const size_t KNOT_KEY_BLOCK_OFFSET = KNOT_SIGNATURE.size() + 1 + NONCE_SIZE;
+const size_t KNOT_KEY_BLOCK_SIZE   = SALT_SIZE + NONCE_SIZE + KEY_SIZE + TAG_SIZE;
+const size_t KNOT_HEADER_SIZE      = KNOT_KEY_BLOCK_OFFSET + KNOT_KEY_BLOCK_SIZE;
+
+/** The immutable part of the header, used as associated data. */
+std::vector<uint8_t> serializeHeaderPrefix(const KnotHeader& header) {
+    std::vector<uint8_t> bytes(KNOT_SIGNATURE.begin(), KNOT_SIGNATURE.end());
+    bytes.push_back(static_cast<uint8_t>(header.cipher));
+    bytes.insert(bytes.end(), header.nonce.begin(), header.nonce.end());
+    return bytes;
+}
+
+std::vector<uint8_t> serializeKeyBlock(const KnotHeader& header) {
+    std::vector<uint8_t> bytes(header.salt);
+    bytes.insert(bytes.end(), header.wrapNonce.begin(),  header.wrapNonce.end());
+    bytes.insert(bytes.end(), header.wrappedKey.begin(), header.wrappedKey.end());
+    bytes.insert(bytes.end(), header.wrapTag.begin(),    header.wrapTag.end());
+    return bytes;
+}
+
+std::vector<uint8_t> serializeHeader(const KnotHeader& header) {
+    std::vector<uint8_t> bytes = serializeHeaderPrefix(header);
+    std::vector<uint8_t> block = serializeKeyBlock(header);
+    bytes.insert(bytes.end(), block.begin(), block.end());
+    return bytes;
+}
+
+/** Read a header, leaving `in` positioned at the start of the ciphertext. */
+KnotHeader readHeader(std::istream& in) {
+    std::array<char, 8> signature;
+    in.read(signature.data(), signature.size());
+    if (in && signature == KNOT_LEGACY_SIGNATURE) {
+        throw std::runtime_error("Legacy KNOTENC1 file, decrypt and re-encrypt it first");
     }
-    
-    return key;
+    if (!in || signature != KNOT_SIGNATURE) {
+        throw std::runtime_error("Not a Knot encrypted file");
+    }
+
+    KnotHeader header;
+    uint8_t cipher = 0;
+    header.nonce.resize(NONCE_SIZE);
+    header.salt.resize(SALT_SIZE);
+    header.wrapNonce.resize(NONCE_SIZE);
+    header.wrappedKey.resize(KEY_SIZE);
+    in.read(reinterpret_cast<char*>(&cipher), 1);
+    in.read(reinterpret_cast<char*>(header.nonce.data()),      NONCE_SIZE);
+    in.read(reinterpret_cast<char*>(header.salt.data()),       SALT_SIZE);
+    in.read(reinterpret_cast<char*>(header.wrapNonce.data()),  NONCE_SIZE);
+    in.read(reinterpret_cast<char*>(header.wrappedKey.data()), KEY_SIZE);
+    in.read(reinterpret_cast<char*>(header.wrapTag.data()),    TAG_SIZE);
+    if (!in) throw std::runtime_error("Truncated Knot header");
+
+    header.cipher = toCipherId(cipher);
+    return header;
 }
 
+/**
+ * Seal `dataKey` under `password` into the key block of `header`, using a
+ * fresh salt and wrap nonce.
+ * @note `header.cipher` and `header.nonce` must already be set.
+ */
+void wrapDataKey(KnotHeader& header, const std::string& password, const std::vector<uint8_t>& dataKey) {
+    header.salt      = generateRandomBytes(SALT_SIZE);
+    header.wrapNonce = generateRandomBytes(NONCE_SIZE);
+    auto kek = deriveKey(password, header.salt);
+    KeyGuard wipeKek(kek);
 
-const std::array<char, 8> KNOT_SIGNATURE = {'K', 'N', 'O', 'T', 'E', 'N', 'C', '1'};
+    header.wrapTag = sealBytes(header.cipher, dataKey, header.wrappedKey, kek, header.wrapNonce, serializeHeaderPrefix(header));
+}
+
+/**
+ * Recover the data key from the key block of `header`.
+ * @throws std::runtime_error if the password is wrong or the header was tampered with.
+ * @note Callers wipe the returned key with a `KeyGuard`.
+ */
+std::vector<uint8_t> unwrapDataKey(const KnotHeader& header, const std::string& password) {
+    auto kek = deriveKey(password, header.salt);
+    KeyGuard wipeKek(kek);
+
+    return openBytes(header.cipher, header.wrappedKey, kek, header.wrapNonce, serializeHeaderPrefix(header), header.wrapTag);
+}
 
 
 /**
@@ -188,6 +270,11 @@ struct Config {
     std::vector<std::string> extensions;
     std::vector<std::string> specific_files;
     std::vector<std::string> skip_folders;
+    std::string              cipher = "auto"; // "auto", "aes-256-gcm" or "chacha20-poly1305"
+    std::string              log_level = "info"; // "error", "info" or "verbose"
+    bool                     progress  = false;  // status line instead of per-file lines
+    bool                     bulk_io   = false;  // keep file data out of the page cache
+    double                   max_io_mib_per_sec = 0; // I/O bandwidth cap, 0 = unlimited
 };
 
 
@@ -229,6 +316,33 @@ Config parseConfigFile(const std::string& filename) {
                 }
             }
         }
+
+        if (auto* cipher = std::get_if<std::string>(&(*obj)["cipher"])) {
+            config.cipher = *cipher;
+            toLower(config.cipher);
+            strip(config.cipher);
+        }
+
+        if (auto* log_level = std::get_if<std::string>(&(*obj)["log_level"])) {
+            config.log_level = *log_level;
+            toLower(config.log_level);
+            strip(config.log_level);
+        }
+
+        if (auto* progress = std::get_if<bool>(&(*obj)["progress"])) {
+            config.progress = *progress;
+        }
+
+        if (auto* bulk_io = std::get_if<bool>(&(*obj)["bulk_io"])) {
+            config.bulk_io = *bulk_io;
+        }
+
+        const auto& max_io = (*obj)["max_io_mib_per_sec"];
+        if (auto* mib = std::get_if<int_fast64_t>(&max_io)) {
+            config.max_io_mib_per_sec = static_cast<double>(*mib);
+        } else if (auto* mib = std::get_if<double>(&max_io)) {
+            config.max_io_mib_per_sec = *mib;
+        }
     } else {
         throw std::runtime_error("Invalid JSON format in config file");
     }
@@ -236,13 +350,29 @@ Config parseConfigFile(const std::string& filename) {
     return config;
 }
 
+/** I/O settings of `config`; also arms the process-wide rate limiter. */
+IoOptions configureIo(const Config& config) {
+    IoOptions io;
+    io.bulk              = config.bulk_io;
+    io.maxBytesPerSecond = config.max_io_mib_per_sec > 0
+                         ? static_cast<uint64_t>(config.max_io_mib_per_sec * 1024 * 1024) : 0;
+    RateLimiter::instance().setRate(io.maxBytesPerSecond);
+    return io;
+}
+
+/** Apply the logging settings of `config` to the global logger. */
+void configureLogger(const Config& config) {
+    Logger::instance().setLevel(parseLogLevel(config.log_level));
+    Logger::instance().setProgress(config.progress);
+}
+
 
 std::vector<std::string> getTargetFiles(const Config& config, int maxDepth = -1) {
     std::vector<std::string> targetFiles;
     
     fs::path currentFilePath = fs::current_path();
     fs::path parentPath      = currentFilePath.parent_path();
-    std::cout << "Searching for files with targeted extension(s) in: " << parentPath << std::endl;
+    logInfo("Searching for files with targeted extension(s) in: ", parentPath);
 
     std::function<void(const fs::path&, int)> searchDirectory = 
         [&](const fs::path& path, int depth) {
@@ -255,7 +385,7 @@ std::vector<std::string> getTargetFiles(const Config& config, int maxDepth = -1)
                     for (const auto& skip_pattern : config.skip_folders) {
                         if (matchesWildcard(entry.path().string(), skip_pattern)) {
                             skip = true;
-                            std::cout << "Skipping folder: " << entry.path() << std::endl;
+                            logVerbose("Skipping folder: ", entry.path());
                             break;
                         }
                     }
@@ -278,15 +408,15 @@ std::vector<std::string> getTargetFiles(const Config& config, int maxDepth = -1)
         fs::path filePath = fs::absolute(file);
         if (fs::is_regular_file(filePath)) {
             targetFiles.push_back(filePath.string());
-            std::cout << "Found specific file: " << filePath << std::endl;
+            logVerbose("Found specific file: ", filePath);
         } else {
-            std::cout << "Skipping non-regular file: " << filePath << std::endl;
+            logInfo("Skipping non-regular file: ", filePath);
         }
     }
 
     searchDirectory(parentPath, 0);
 
-    std::cout << "Total target files found: " << targetFiles.size() << std::endl;
+    logInfo("Total target files found: ", targetFiles.size());
     return targetFiles;
 }
 
@@ -300,7 +430,7 @@ bool isKnotEncryptedFile(const std::string& filename) {
     std::array<char, 8> signature;
     file.read(signature.data(), signature.size());
 
-    return (file && signature == KNOT_SIGNATURE);
+    return (file && (signature == KNOT_SIGNATURE || signature == KNOT_LEGACY_SIGNATURE));
 }
 
 /**
@@ -310,7 +440,7 @@ std::vector<std::string> findKnotFiles() {
     std::vector<std::string> knotFiles;
     fs::path parentPath = fs::current_path().parent_path();
 
-    std::cout << "Searching for .knot files in: " << parentPath << std::endl;
+    logInfo("Searching for .knot files in: ", parentPath);
 
     for (const auto& entry : fs::recursive_directory_iterator(parentPath)) {
         if (fs::is_regular_file(entry) && entry.path().extension() == ".knot") {
@@ -327,8 +457,8 @@ std::vector<std::string> findKnotFiles() {
 void removeKnotFile(const std::string& filename) {
     if (isKnotEncryptedFile(filename)) {
         fs::remove(filename);
-        std::cout << "Removed: " << filename << std::endl;
+        logFile("Removed: ", filename);
     } else {
-        std::cout << "Skipped (not a Knot encrypted file): " << filename << std::endl;
+        logFile("Skipped (not a Knot encrypted file): ", filename);
     }
 }
\ No newline at end of file
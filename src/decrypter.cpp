@@ -6,20 +6,17 @@
 ================================================================= */
 #include "common.hpp"
 
+#include <optional>
+
 #ifdef _WIN32
 #include <direct.h>
 #endif
 
-void decryptFile(const std::string& filename, const std::string& password) {
-    std::filesystem::path filePath = std::filesystem::absolute(filename);
-    if (!isKnotEncryptedFile(filename))
-        throw std::runtime_error("Invalid file format: " + filePath.string());
-
-    std::ifstream inFile(filePath, std::ios::binary);
-    std::array<char, 8> signature;
-    inFile.read(signature.data(), KNOT_SIGNATURE.size()); // Skip the signature bytes.
-    
-
+/**
+ * Decrypt a file written by the original XOR scheme (`KNOTENC1`).
+ * @note Kept only so existing `.knot` files remain readable.
+ */
+void decryptLegacyFile(std::istream& inFile, std::ostream& outFile, const std::string& password) {
     std::vector<uint8_t> salt(SALT_SIZE);
     inFile.read(reinterpret_cast<char*>(salt.data()), SALT_SIZE);
     std::vector<uint8_t> iv(IV_SIZE);
@@ -27,12 +24,6 @@ void decryptFile(const std::string& filename, const std::string& password) {
 
     auto key = deriveKey(password, salt);
 
-    std::filesystem::path outPath = filePath.parent_path() / filePath.stem();
-    std::ofstream outFile(outPath, std::ios::binary);
-    if (!outFile) {
-        throw std::runtime_error("Unable to create output file: " + outPath.string());
-    }
-
     std::vector<uint8_t> buffer(1024);
     size_t position = 0;
     while (inFile.read(reinterpret_cast<char*>(buffer.data()), buffer.size()) || inFile.gcount() > 0) {
@@ -43,14 +34,87 @@ void decryptFile(const std::string& filename, const std::string& password) {
         }
         outFile.write(reinterpret_cast<char*>(buffer.data()), bytesRead);
     }
-    /** Ensure overall integrity at the end. */
-    if (inFile.bad())  throw std::runtime_error("Error reading from file: " + filePath.string());
-    if (outFile.bad()) throw std::runtime_error("Error writing to file: " + outPath.string());
-
-    inFile.close();
-    outFile.close();
 }
 
+/**
+ * Decrypt `filename` (a `.knot` file) next to it, without the extension,
+ * through a temp file recorded in `journal`.
+ * @returns the number of data bytes decrypted.
+ */
+uint64_t decryptFile(const std::string& filename, const std::string& password, const IoOptions& io, Journal& journal) {
+    std::filesystem::path filePath = std::filesystem::absolute(filename);
+    if (!isKnotEncryptedFile(filename))
+        throw std::runtime_error("Invalid file format: " + filePath.string());
+
+    auto inBuf = openFileBuf(filePath, std::ios::in, io);
+    if (!inBuf) {
+        throw std::runtime_error("Unable to open input file: " + filePath.string());
+    }
+    std::istream inFile(inBuf.get());
+    std::array<char, 8> signature;
+    inFile.read(signature.data(), signature.size());
+
+    std::filesystem::path outPath  = filePath.parent_path() / filePath.stem();
+    std::filesystem::path tempPath = journal.beginOutput(outPath);
+    auto outBuf = openFileBuf(tempPath, std::ios::out, io);
+    if (!outBuf) {
+        std::filesystem::remove(tempPath);
+        throw std::runtime_error("Unable to create output file: " + tempPath.string());
+    }
+    std::ostream outFile(outBuf.get());
+
+    /** Size to restore once written; trailing holes are never written. */
+    std::optional<uint64_t> logicalSize;
+    uint64_t                processed = 0;
+    try {
+        if (signature == KNOT_LEGACY_SIGNATURE) {
+            decryptLegacyFile(inFile, outFile, password);
+            processed = std::filesystem::file_size(filePath);
+        } else {
+            inFile.seekg(0);
+            KnotHeader header = readHeader(inFile);
+
+            uint64_t fileSize = std::filesystem::file_size(filePath);
+            if (fileSize < KNOT_HEADER_SIZE + TAG_SIZE)
+                throw std::runtime_error("Truncated file: " + filePath.string());
+            SparseMap sparseMap = readSparseMap(inFile, (fileSize - KNOT_HEADER_SIZE) / 16);
+            auto mapBytes = serializeSparseMap(sparseMap);
+
+            uint64_t bodyOffset = KNOT_HEADER_SIZE + mapBytes.size();
+            if (fileSize < bodyOffset + TAG_SIZE || fileSize - bodyOffset - TAG_SIZE != sparseMap.dataSize())
+                throw std::runtime_error("Corrupted file: " + filePath.string());
+
+            AuthTag tag;
+            inFile.seekg(fileSize - TAG_SIZE);
+            inFile.read(reinterpret_cast<char*>(tag.data()), tag.size());
+            inFile.seekg(bodyOffset);
+
+            auto aad = serializeHeaderPrefix(header);
+            aad.insert(aad.end(), mapBytes.begin(), mapBytes.end());
+
+            auto dataKey = unwrapDataKey(header, password);
+            KeyGuard wipeKey(dataKey);
+            decryptStream(header.cipher, inFile, outFile, sparseMap.extents, dataKey, header.nonce, aad, tag);
+            logicalSize = sparseMap.size;
+            processed   = sparseMap.dataSize();
+        }
+        /** Ensure overall integrity at the end. */
+        if (inFile.bad())  throw std::runtime_error("Error reading from file: " + filePath.string());
+        if (!outFile.flush() || !closeFileBuf(outBuf))
+            throw std::runtime_error("Error writing to file: " + tempPath.string());
+        if (logicalSize)   std::filesystem::resize_file(tempPath, *logicalSize);
+
+        commitFile(tempPath, outPath);
+    } catch (...) {
+        // Never leave partial or unauthenticated plaintext behind.
+        closeFileBuf(outBuf);
+        std::filesystem::remove(tempPath);
+        throw;
+    }
+
+    closeFileBuf(inBuf);
+    return processed;
+}
 
 
 int main() {
@@ -64,24 +128,54 @@ int main() {
             }
         }
 
-        std::cout << "Files to be decrypted:" << std::endl;
+        Config config;
+        if (std::filesystem::exists("config.json")) {
+            config = parseConfigFile("config.json");
+        }
+        configureLogger(config);
+        IoOptions io = configureIo(config);
+
+        logInfo("Files to be decrypted: ", knotFiles.size());
         for (const auto& file : knotFiles) {
-            std::cout << file << std::endl;
+            logVerbose(file);
         }
         
         std::string password = getPassword();
-        
+
+        Journal journal(std::filesystem::current_path() / "decrypter.journal", password);
+        auto outputFor = [](const std::string& file) {
+            std::filesystem::path path(file);
+            return path.parent_path() / path.stem();
+        };
+        size_t pending = std::count_if(knotFiles.begin(), knotFiles.end(),
+                                       [&](const std::string& file) { return !journal.isDone(file, outputFor(file)); });
+        if (pending < knotFiles.size()) {
+            logInfo("Resuming interrupted run, ", knotFiles.size() - pending, " file(s) already decrypted");
+        }
+        Logger::instance().startProgress(pending);
+
+        bool failed = false;
         for (const auto& file : knotFiles) {
-            std::cout << "Processing file: " << file << std::endl;
+            if (journal.isDone(file, outputFor(file))) continue;
+
+            logVerbose("Processing file: ", file);
             try {
-                decryptFile(file, password);
-                std::cout << "Successfully decrypted: " << file << std::endl;
+                auto source = fileStamp(file);
+                if (!source) throw std::runtime_error("File not found");
+                uint64_t bytes = decryptFile(file, password, io, journal);
+                journal.markDone(file, *source, outputFor(file));
+                Logger::instance().fileDone(bytes);
+                logFile("Successfully decrypted: ", file);
             } catch (const std::exception& e) {
-                std::cerr << "Error decrypting " << file << ": " << e.what() << std::endl;
+                failed = true;
+                Logger::instance().fileFailed();
+                logError("Error decrypting ", file, ": ", e.what());
             }
         }
+
+        if (!failed) journal.finish();
     } catch (const std::exception& e) {
-        std::cerr << "An error occurred: " << e.what() << std::endl;
+        logError("An error occurred: ", e.what());
         return 1;
     }
     
@@ -10,55 +10,76 @@
 #include <direct.h>
 #endif
 
-void encryptFile(const std::string& filename, const std::string& password) {
-    std::cout << "Starting encryption of file: " << filename << std::endl;
+/**
+ * Encrypt `filename` into `filename.knot`, through a temp file recorded in `journal`.
+ * @returns the number of data bytes encrypted (holes excluded).
+ */
+uint64_t encryptFile(const std::string& filename, const std::string& password, CipherId cipher, const IoOptions& io, Journal& journal) {
+    logVerbose("Starting encryption of file: ", filename);
     std::filesystem::path filePath = std::filesystem::absolute(filename);
     
-    std::ifstream inFile(filePath, std::ios::binary);
-    if (!inFile) {
+    auto inBuf = openFileBuf(filePath, std::ios::in, io);
+    if (!inBuf) {
         throw std::runtime_error("Unable to open input file: " + filePath.string());
     }
+    std::istream inFile(inBuf.get());
 
-    std::filesystem::path outPath = filePath.parent_path() / (filePath.filename().string() + ".knot");
-    std::ofstream outFile(outPath, std::ios::binary);
-    if (!outFile) {
-        throw std::runtime_error("Unable to create output file: " + outPath.string());
+    std::filesystem::path outPath  = filePath.parent_path() / (filePath.filename().string() + ".knot");
+    std::filesystem::path tempPath = journal.beginOutput(outPath);
+    auto outBuf = openFileBuf(tempPath, std::ios::out, io);
+    if (!outBuf) {
+        std::filesystem::remove(tempPath);
+        throw std::runtime_error("Unable to create output file: " + tempPath.string());
     }
+    std::ostream outFile(outBuf.get());
     
-    // =====================================================
-    // Writing signature, salt, iv
-    // =====================================================
-    
-    auto salt = generateRandomBytes(SALT_SIZE);
-    auto iv   = generateRandomBytes(IV_SIZE);
-    outFile.write(KNOT_SIGNATURE.data(), KNOT_SIGNATURE.size());
-    outFile.write(reinterpret_cast<char*>(salt.data()), salt.size());
-    outFile.write(reinterpret_cast<char*>(iv.data()), iv.size());
+    uint64_t processed = 0;
+    try {
+        // =====================================================
+        // Writing header (signature, cipher, nonce, key block)
+        // =====================================================
+        KnotHeader header;
+        header.cipher = cipher;
+        header.nonce  = generateRandomBytes(NONCE_SIZE);
 
-    // =====================================================
-    // Deriving key from password & salt
-    // =====================================================
-    /** Encryption key */
-    auto key = deriveKey(password, salt);
+        /** Random per-file key for the body, wrapped by the password. */
+        auto dataKey = generateRandomBytes(KEY_SIZE);
+        KeyGuard wipeKey(dataKey);
+        wrapDataKey(header, password, dataKey);
 
-    std::vector<uint8_t> buffer(1024);
-    size_t position = 0;
-    while (inFile.read(reinterpret_cast<char*>(buffer.data()), buffer.size()) || inFile.gcount() > 0) {
-        size_t bytesRead = inFile.gcount();
-        
-        for (size_t i = 0; i < bytesRead; ++i) {
-            buffer[i] ^= key[position % key.size()] ^ iv[position % iv.size()];
-            position++;
+        auto headerBytes = serializeHeader(header);
+        outFile.write(reinterpret_cast<char*>(headerBytes.data()), headerBytes.size());
+
+        // =====================================================
+        // Extent map, then only the data regions are encrypted
+        // =====================================================
+        SparseMap sparseMap = findDataExtents(filePath);
+        if (sparseMap.dataSize() < sparseMap.size) {
+            logVerbose("Sparse file: ", sparseMap.dataSize(), " of ", sparseMap.size, " bytes are data");
         }
-        outFile.write(reinterpret_cast<char*>(buffer.data()), bytesRead);
-    }
+        processed     = sparseMap.dataSize();
+        auto mapBytes = serializeSparseMap(sparseMap);
+        outFile.write(reinterpret_cast<char*>(mapBytes.data()), mapBytes.size());
+
+        auto aad = serializeHeaderPrefix(header);
+        aad.insert(aad.end(), mapBytes.begin(), mapBytes.end());
+
+        AuthTag tag = encryptStream(cipher, inFile, outFile, sparseMap.extents, dataKey, header.nonce, aad);
+        outFile.write(reinterpret_cast<char*>(tag.data()), tag.size());
 
-    // ~~~~~~~~ Ensure overall integrity at the end ~~~~~~~~
-    if (inFile.bad())  throw std::runtime_error("Error reading from file: " + filePath.string());
-    if (outFile.bad()) throw std::runtime_error("Error writing to file: " + outPath.string());
+        // ~~~~~~~~ Ensure overall integrity at the end ~~~~~~~~
+        if (inFile.bad())  throw std::runtime_error("Error reading from file: " + filePath.string());
+        if (!outFile.flush() || !closeFileBuf(outBuf))
+            throw std::runtime_error("Error writing to file: " + tempPath.string());
 
-    inFile.close();
-    outFile.close();
+        // Only a complete file ever appears under the .knot name.
+        commitFile(tempPath, outPath);
+    } catch (...) {
+        closeFileBuf(outBuf);
+        std::filesystem::remove(tempPath);
+        throw;
+    }
+    closeFileBuf(inBuf);
 
     // =====================================================
     // Create a reference copycat file for github display
@@ -86,41 +107,77 @@ void encryptFile(const std::string& filename, const std::string& password) {
     if (!emptyFile) {
         throw std::runtime_error("Error writing to reference file: " + emptyFilePath.string());
     }
+    return processed;
 }
 
 int main() {
     try {
-        std::cout << "=== Parsing config ===" << std::endl;
+        logInfo("=== Parsing config ===");
         Config config = parseConfigFile("config.json");
+        configureLogger(config);
         
-        std::cout << "Targeted Extensions: ";
+        std::string extensions;
         for (const auto& ext : config.extensions) {
-            std::cout << ext << " ";
+            extensions += ext + " ";
+        }
+        logInfo("Targeted Extensions: ", extensions);
+
+        IoOptions io = configureIo(config);
+        if (io.bulk) {
+            logInfo("Bulk I/O: keeping file data out of the page cache");
         }
-        std::cout << std::endl;
+        if (io.maxBytesPerSecond > 0) {
+            logInfo("I/O capped at ", config.max_io_mib_per_sec, " MiB/s");
+        }
+
+        CipherId cipher = parseCipherName(config.cipher);
+        logInfo("Cipher: ", cipherName(cipher), (config.cipher == "auto" ? " (auto-detected)" : ""));
 
         std::vector<std::string> targetFiles = getTargetFiles(config);
         
-        std::cout << "Target files to be encrypted:";
+        logVerbose("Target files to be encrypted:");
         for (const auto& file : targetFiles) {
-            std::cout << file << std::endl;
+            logVerbose(file);
         }
         
         std::string password = getPassword();
-        
+
+        Journal journal(std::filesystem::current_path() / "encrypter.journal", password);
+        auto outputFor = [](const std::string& file) { return file + ".knot"; };
+        size_t pending = std::count_if(targetFiles.begin(), targetFiles.end(),
+                                       [&](const std::string& file) { return !journal.isDone(file, outputFor(file)); });
+        if (pending < targetFiles.size()) {
+            logInfo("Resuming interrupted run, ", targetFiles.size() - pending, " file(s) already encrypted");
+        }
+        Logger::instance().startProgress(pending);
+
+        bool failed = false;
         for (const auto& file : targetFiles) {
-            std::cout << "Processing file: " << file << std::endl;
+            if (journal.isDone(file, outputFor(file))) continue;
+
+            logVerbose("Processing file: ", file);
             try {
-                encryptFile(file, password);
-                std::cout << "Successfully encrypted: " << file << std::endl;
+                auto source = fileStamp(file);
+                if (!source) throw std::runtime_error("File not found");
+                uint64_t bytes = encryptFile(file, password, cipher, io, journal);
+                journal.markDone(file, *source, outputFor(file));
+                Logger::instance().fileDone(bytes);
+                logFile("Successfully encrypted: ", file);
             } catch (const std::exception& e) {
-                std::cerr << "Error encrypting " << file << ": " << e.what() << std::endl;
+                failed = true;
+                Logger::instance().fileFailed();
+                logError("Error encrypting ", file, ": ", e.what());
             } catch (...) {
-                std::cerr << "Unknown error occurred while encrypting " << file << std::endl;
+                failed = true;
+                Logger::instance().fileFailed();
+                logError("Unknown error occurred while encrypting ", file);
             }
         }
+
+        // Keep the journal after failures so a re-run only retries those.
+        if (!failed) journal.finish();
     } catch (const std::exception& e) {
-        std::cerr << "An error occurred: " << e.what() << std::endl;
+        logError("An error occurred: ", e.what());
         return 1;
     }
     
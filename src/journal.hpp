@@ -0,0 +1,314 @@
+/** ================================================================
+| journal.hpp  --  src/journal.hpp
+|
+| Created by Jack on 10/18, 2026
+| Copyright © 2024 jacktogon. All rights reserved.
+================================================================= */
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <optional>
+#include <stdexcept>
+#include <filesystem>
+#include <system_error>
+#include <unordered_map>
+#include "logger.hpp"
+#include "keys.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+std::string toHex(const std::vector<uint8_t>& bytes) {
+    static const char* digits = "0123456789abcdef";
+    std::string hex;
+    for (uint8_t b : bytes) {
+        hex += digits[b >> 4];
+        hex += digits[b & 0x0F];
+    }
+    return hex;
+}
+
+std::vector<uint8_t> fromHex(const std::string& hex) {
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    };
+    std::vector<uint8_t> bytes;
+    if (hex.size() % 2 != 0) return bytes;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int high = nibble(hex[i]), low = nibble(hex[i + 1]);
+        if (high < 0 || low < 0) return {};
+        bytes.push_back(static_cast<uint8_t>((high << 4) | low));
+    }
+    return bytes;
+}
+
+
+/**
+ * Flush a closed file's data to stable storage.
+ * @note Needed before `commitFile()`'s rename, otherwise a power loss can
+ *       leave a renamed but empty file behind.
+ */
+void syncFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.wstring().c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) throw std::runtime_error("Unable to open for sync: " + path.string());
+    BOOL ok = FlushFileBuffers(handle);
+    CloseHandle(handle);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Unable to open for sync: " + path.string());
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+#endif
+    if (!ok) throw std::runtime_error("Unable to sync file: " + path.string());
+}
+
+/**
+ * Create the file an output is written under until it is complete:
+ * `<final>-<random>.partial`, created exclusively so it can never be a file
+ * that already existed. Only the returned path may be removed on failure.
+ */
+std::filesystem::path createTempFile(const std::filesystem::path& finalPath) {
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        std::filesystem::path path = finalPath.string() + "-" + toHex(generateRandomBytes(8)) + ".partial";
+#ifdef _WIN32
+        HANDLE handle = CreateFileW(path.wstring().c_str(), GENERIC_WRITE, 0, nullptr,
+                                    CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle);
+            return path;
+        }
+        if (GetLastError() != ERROR_FILE_EXISTS) break;
+#else
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0) {
+            ::close(fd);
+            return path;
+        }
+        if (errno != EEXIST) break;
+#endif
+    }
+    throw std::runtime_error("Unable to create temp file for: " + finalPath.string());
+}
+
+/**
+ * Flush a directory's entries, so a rename inside it survives a power loss.
+ * @note No-op on Windows, where a rename is not persisted this way.
+ */
+void syncDirectory(const std::filesystem::path& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) throw std::runtime_error("Unable to open for sync: " + path.string());
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok) throw std::runtime_error("Unable to sync directory: " + path.string());
+#else
+    (void)path;
+#endif
+}
+
+/** Atomically and durably move a fully written temp file onto its final name. */
+void commitFile(const std::filesystem::path& tempPath, const std::filesystem::path& finalPath) {
+    syncFile(tempPath);
+    std::filesystem::rename(tempPath, finalPath);
+    syncDirectory(std::filesystem::absolute(finalPath).parent_path());
+}
+
+
+/** Size and modification time of a file, to tell whether it changed. */
+struct FileStamp {
+    uint64_t size  = 0;
+    int64_t  mtime = 0;
+
+    bool operator==(const FileStamp& other) const { return size == other.size && mtime == other.mtime; }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+/** @returns `std::nullopt` if `path` does not exist (or cannot be read). */
+std::optional<FileStamp> fileStamp(const std::filesystem::path& path) {
+    std::error_code ec;
+    FileStamp stamp;
+    stamp.size = std::filesystem::file_size(path, ec);
+    if (ec) return std::nullopt;
+    auto time = std::filesystem::last_write_time(path, ec);
+    if (ec) return std::nullopt;
+    stamp.mtime = static_cast<int64_t>(time.time_since_epoch().count());
+    return stamp;
+}
+
+
+/**
+ * Append-only log of files a run has finished, so an interrupted run can
+ * resume instead of starting over.
+ *
+ *   KNOTJOURNAL1 <salt> <password check>
+ *   temp <temp path>
+ *   done <src size> <src mtime> <out size> <out mtime> <src path>
+ *   ...
+ *
+ * The header binds the journal to the password of its run: a run with
+ * another password refuses to start rather than lose finished work (a
+ * journal without finished files is simply replaced). Each entry is
+ * appended only after its output has been committed and records both files'
+ * size and mtime; a file only counts as done while both still match, so
+ * edited sources and missing or replaced outputs are processed again.
+ * `temp` entries are written ahead of each output's temp file, so temp files
+ * left behind by a killed run are removed when the next run opens the
+ * journal. The journal is removed by `finish()` once a run ends without
+ * errors.
+ */
+class Journal {
+public:
+    Journal(const std::filesystem::path& journalPath, const std::string& password) : path(journalPath) {
+        bool resumed = load(password);
+        for (const auto& temp : leftovers) {
+            std::error_code ec;
+            if (std::filesystem::remove(temp, ec)) logVerbose("Removed leftover temp file: ", temp);
+        }
+        leftovers.clear();
+
+        if (!resumed) {
+            done.clear();
+            needsNewline = false;
+            salt = generateRandomBytes(SALT_SIZE);
+            out.open(path, std::ios::binary | std::ios::trunc);
+            out << JOURNAL_MAGIC << ' ' << toHex(salt) << ' ' << toHex(deriveKey(password, salt)) << '\n' << std::flush;
+        } else {
+            out.open(path, std::ios::binary | std::ios::app);
+            if (needsNewline) out << '\n' << std::flush;
+        }
+        if (!out) throw std::runtime_error("Unable to open journal: " + path.string());
+    }
+
+    /** Whether `file` was finished by this run and neither it nor `output` changed since. */
+    bool isDone(const std::string& file, const std::filesystem::path& output) const {
+        auto it = done.find(file);
+        if (it == done.end()) return false;
+        auto src = fileStamp(file);
+        auto dst = fileStamp(output);
+        return src && dst && *src == it->second.source && *dst == it->second.output;
+    }
+
+    /**
+     * Create the temp file `finalPath` is written under (see `createTempFile()`)
+     * and record it, so it is cleaned up if the run is killed.
+     */
+    std::filesystem::path beginOutput(const std::filesystem::path& finalPath) {
+        std::filesystem::path temp = createTempFile(finalPath);
+        try {
+            append("temp " + temp.string());
+        } catch (...) {
+            std::filesystem::remove(temp);
+            throw;
+        }
+        return temp;
+    }
+
+    /**
+     * Record `file` as finished.
+     * @param source stamp of `file` taken before it was processed, so edits
+     *               made while processing make the entry stale.
+     */
+    void markDone(const std::string& file, const FileStamp& source, const std::filesystem::path& output) {
+        auto dst = fileStamp(output);
+        if (!dst) throw std::runtime_error("Output missing after commit: " + output.string());
+
+        std::ostringstream entry;
+        entry << "done " << source.size << ' ' << source.mtime << ' ' << dst->size << ' ' << dst->mtime << ' ' << file;
+        append(entry.str());
+        done[file] = {source, *dst};
+    }
+
+    /** Remove the journal; the next run starts from scratch. */
+    void finish() {
+        out.close();
+        std::filesystem::remove(path);
+    }
+
+private:
+    static constexpr const char* JOURNAL_MAGIC = "KNOTJOURNAL1";
+
+    struct Entry {
+        FileStamp source;
+        FileStamp output;
+    };
+
+    /** Append one line and make it durable before anything depends on it. */
+    void append(const std::string& line) {
+        out << line << '\n' << std::flush;
+        if (!out) throw std::runtime_error("Unable to write journal: " + path.string());
+        syncFile(path);
+    }
+
+    /**
+     * Read an existing journal written with `password`.
+     * @returns `false` if there is none, or if it was written with another
+     *          password but holds no finished files, so nothing is lost by
+     *          starting a new one.
+     * @throws std::runtime_error (leaving the journal untouched) if it holds
+     *         finished files under another password, or is not a journal.
+     */
+    bool load(const std::string& password) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+
+        std::string header;
+        if (!std::getline(in, header) || in.eof()) return false; // torn while being created, no entries yet
+        std::istringstream fields(header);
+        std::string magic, saltHex, checkHex;
+        fields >> magic >> saltHex >> checkHex;
+        salt = fromHex(saltHex);
+        if (magic != JOURNAL_MAGIC || salt.empty()) {
+            throw std::runtime_error(path.string() + " is not a Knot journal; move it away to start over");
+        }
+
+        std::string line;
+        while (std::getline(in, line)) {
+            if (in.eof()) {
+                needsNewline = true; // torn last write, it is not a real entry
+                break;
+            }
+            std::istringstream entry(line);
+            std::string kind, file;
+            Entry stamps;
+            entry >> kind;
+            if (kind == "done") {
+                entry >> stamps.source.size >> stamps.source.mtime >> stamps.output.size >> stamps.output.mtime;
+            }
+            entry.get(); // the separating space
+            std::getline(entry, file);
+            if (entry.fail() || file.empty()) continue;
+
+            if (kind == "temp")      leftovers.push_back(file);
+            else if (kind == "done") done[file] = stamps;
+        }
+
+        if (toHex(deriveKey(password, salt)) != checkHex) {
+            if (done.empty()) return false;
+            throw std::runtime_error(
+                "The password does not match the interrupted run in " + path.string()
+                + " (" + std::to_string(done.size()) + " file(s) finished). Re-run with the same "
+                "password, or delete the journal to start over.");
+        }
+        return true;
+    }
+
+    std::filesystem::path                  path;
+    std::vector<uint8_t>                   salt;
+    std::unordered_map<std::string, Entry> done;
+    std::vector<std::filesystem::path>     leftovers; // temp files of the previous run
+    std::ofstream                          out;
+    bool                                   needsNewline = false;
+};
@@ -0,0 +1,71 @@
+/** ================================================================
+| keys.hpp  --  src/keys.hpp
+|
+| Created by Jack on 10/18, 2026
+| Copyright © 2024 jacktogon. All rights reserved.
+================================================================= */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+const int SALT_SIZE = 16, 
+          KEY_SIZE  = 32, // 256bits
+          IV_SIZE   = 16;
+
+/** 
+ * Generates a vector of random (0 ~ 255) bytes.
+ * @note Uses OpenSSL's CSPRNG; salts and AEAD nonces must be unpredictable.
+ * @example
+ * auto ten_random_bytes = generateRandomBytes(10);
+ */
+std::vector<uint8_t> generateRandomBytes(size_t size) {
+    std::vector<uint8_t> bytes(size);
+    if (RAND_bytes(bytes.data(), static_cast<int>(size)) != 1) {
+        throw std::runtime_error("Unable to generate random bytes");
+    }
+    return bytes;
+}
+
+
+/** Derive a key from combining `password` and `salt` with SHA256 */
+std::vector<uint8_t> deriveKey(const std::string& password, const std::vector<uint8_t>& salt) {
+    std::vector<uint8_t> key(KEY_SIZE);
+    if (PKCS5_PBKDF2_HMAC(
+            password.c_str(), 
+            password.length(),
+            salt.data(),      
+            salt.size(),
+            10000,        // 10000 iterations
+            EVP_sha256(),
+            KEY_SIZE,
+            key.data()
+        ) != 1
+    ) {
+        throw std::runtime_error("PBKDF2 key derivation failed");
+    }
+    
+    return key;
+}
+
+
+/**
+ * Wipes a key with `OPENSSL_cleanse` when it goes out of scope, including
+ * when an exception unwinds past it.
+ */
+class KeyGuard {
+public:
+    explicit KeyGuard(std::vector<uint8_t>& bytes) : key(bytes) {}
+    ~KeyGuard() { OPENSSL_cleanse(key.data(), key.size()); }
+
+    KeyGuard(const KeyGuard&)            = delete;
+    KeyGuard& operator=(const KeyGuard&) = delete;
+
+private:
+    std::vector<uint8_t>& key;
+};
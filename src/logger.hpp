@@ -0,0 +1,304 @@
+/** ================================================================
+| logger.hpp  --  src/logger.hpp
+|
+| Created by Jack on 10/18, 2026
+| Copyright © 2024 jacktogon. All rights reserved.
+================================================================= */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+enum class LogLevel : int {
+    Error   = 0, // errors only
+    Info    = 1, // one line per processed file (unless in progress mode) and run summaries
+    Verbose = 2, // also target listings, skipped folders, per-file steps
+};
+
+LogLevel parseLogLevel(const std::string& name) {
+    if (name == "error")   return LogLevel::Error;
+    if (name == "info")    return LogLevel::Info;
+    if (name == "verbose") return LogLevel::Verbose;
+    throw std::runtime_error("Unknown log_level in config: " + name);
+}
+
+
+/**
+ * Bounded lock-free multi-producer / single-consumer queue
+ * (Vyukov's sequence-numbered ring buffer).
+ * @note `Capacity` must be a power of two.
+ */
+template <typename T, size_t Capacity>
+class RingBuffer {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    RingBuffer() : cells(new Cell[Capacity]) {
+        for (size_t i = 0; i < Capacity; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /** @returns `false` if the queue is full. */
+    bool tryPush(T&& value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell&    cell = cells[pos & (Capacity - 1)];
+            size_t   seq  = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Only ever called from the single consumer thread. */
+    bool tryPop(T& out) {
+        size_t pos  = tail.load(std::memory_order_relaxed);
+        Cell&  cell = cells[pos & (Capacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1) return false;
+
+        out = std::move(cell.value);
+        cell.sequence.store(pos + Capacity, std::memory_order_release);
+        tail.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T                   value;
+    };
+
+    std::unique_ptr<Cell[]>          cells;
+    alignas(64) std::atomic<size_t>  head{0};
+    alignas(64) std::atomic<size_t>  tail{0};
+};
+
+
+/**
+ * Process-wide asynchronous logger.
+ *
+ * Callers only format their line and push it onto a lock-free ring buffer; a
+ * background thread drains it and writes whole batches to stdout / stderr,
+ * flushing once per batch instead of once per line. In progress mode the
+ * same thread redraws an aggregate status line a few times per second from
+ * atomic counters. With nothing to write and no status line due, the thread
+ * sleeps on a condition variable; callers only touch its mutex when it is
+ * actually asleep.
+ */
+class Logger {
+public:
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    void setLevel(LogLevel value)  { level.store(static_cast<int>(value), std::memory_order_relaxed); }
+    void setProgress(bool enabled) { progress.store(enabled, std::memory_order_relaxed); }
+
+    /**
+     * Level of the one-line-per-file messages: `Info`, but `Verbose` in
+     * progress mode, where the status line already reports each file.
+     */
+    LogLevel fileLevel() const {
+        return progress.load(std::memory_order_relaxed) ? LogLevel::Verbose : LogLevel::Info;
+    }
+
+    bool enabled(LogLevel value) const {
+        return static_cast<int>(value) <= level.load(std::memory_order_relaxed);
+    }
+
+    template <typename... Args>
+    void log(LogLevel value, const Args&... args) {
+        if (!enabled(value)) return;
+        std::ostringstream line;
+        (line << ... << args);
+        push({value, line.str()});
+    }
+
+    /** Block until everything logged so far is on the terminal (e.g. before a prompt). */
+    void flush() {
+        uint64_t target = produced.load(std::memory_order_acquire);
+        while (written.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // ~~~~~~~~ Progress counters, safe to bump from any thread ~~~~~~~~
+    void startProgress(uint64_t totalFiles) {
+        total.store(totalFiles);
+        done.store(0);
+        failed.store(0);
+        bytes.store(0);
+        startTime = std::chrono::steady_clock::now();
+        started.store(true, std::memory_order_release);
+        wake(); // start drawing the status line
+    }
+    void fileDone(uint64_t processedBytes) {
+        bytes.fetch_add(processedBytes, std::memory_order_relaxed);
+        done.fetch_add(1, std::memory_order_relaxed);
+    }
+    void fileFailed() { failed.fetch_add(1, std::memory_order_relaxed); }
+
+    ~Logger() {
+        stopping.store(true, std::memory_order_release);
+        wake();
+        worker.join();
+    }
+
+private:
+    struct Message {
+        LogLevel    level = LogLevel::Info;
+        std::string text;
+    };
+
+    Logger() : worker([this]() { run(); }) {}
+
+    void push(Message&& message) {
+        while (!queue.tryPush(std::move(message))) {
+            std::this_thread::yield(); // full: let the writer catch up rather than drop lines
+        }
+        // seq_cst pairs with the writer's `idle` store in waitForWork()
+        produced.fetch_add(1, std::memory_order_seq_cst);
+        if (idle.load(std::memory_order_seq_cst)) wake();
+    }
+
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wakeRequested = true;
+        }
+        wakeUp.notify_one();
+    }
+
+    /**
+     * Block the writer until a message is queued, `wake()` is called or, if
+     * `until` is set, the next status line is due.
+     */
+    void waitForWork(const std::chrono::steady_clock::time_point* until) {
+        idle.store(true, std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            auto ready = [this]() {
+                return wakeRequested
+                    || produced.load(std::memory_order_seq_cst) != written.load(std::memory_order_relaxed);
+            };
+            if (until) wakeUp.wait_until(lock, *until, ready);
+            else       wakeUp.wait(lock, ready);
+            wakeRequested = false;
+        }
+        idle.store(false, std::memory_order_relaxed);
+    }
+
+    std::string statusLine() const {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        double mib     = bytes.load(std::memory_order_relaxed) / (1024.0 * 1024.0);
+
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(1)
+             << "[" << done.load(std::memory_order_relaxed) << "/" << total.load(std::memory_order_relaxed) << " files";
+        if (uint64_t f = failed.load(std::memory_order_relaxed)) line << ", " << f << " failed";
+        line << "] " << mib << " MiB, " << (seconds > 0 ? mib / seconds : 0.0) << " MiB/s";
+        return line.str();
+    }
+
+    void run() {
+        const auto tick = std::chrono::milliseconds(250);
+        auto       nextStatus = std::chrono::steady_clock::now();
+        size_t     statusWidth = 0;  // width of the status line currently on screen
+        Message    message;
+        std::string out, err;
+
+        auto clearStatus = [&]() {
+            if (statusWidth == 0) return;
+            out += '\r' + std::string(statusWidth, ' ') + '\r';
+            statusWidth = 0;
+        };
+        auto writeBatch = [&]() {
+            if (!out.empty()) { std::fwrite(out.data(), 1, out.size(), stdout); out.clear(); }
+            std::fflush(stdout);
+            if (!err.empty()) { std::fwrite(err.data(), 1, err.size(), stderr); err.clear(); }
+        };
+
+        while (true) {
+            bool     stop  = stopping.load(std::memory_order_acquire);
+            uint64_t count = 0;
+            while (queue.tryPop(message)) {
+                clearStatus();
+                if (message.level == LogLevel::Error) {
+                    // keep stdout/stderr in order
+                    if (!out.empty()) writeBatch();
+                    err += message.text + '\n';
+                } else {
+                    if (!err.empty()) writeBatch();
+                    out += message.text + '\n';
+                }
+                if (out.size() + err.size() > 64 * 1024) writeBatch();
+                ++count;
+            }
+
+            bool drawStatus = progress.load(std::memory_order_relaxed) && started.load(std::memory_order_acquire);
+            auto now        = std::chrono::steady_clock::now();
+            if (drawStatus && (now >= nextStatus || stop)) {
+                clearStatus();
+                std::string status = statusLine();
+                out += status;
+                statusWidth = status.size();
+                nextStatus  = now + tick;
+            }
+
+            if (count > 0 || !out.empty() || !err.empty()) writeBatch();
+            written.fetch_add(count, std::memory_order_release);
+
+            if (stop && count == 0) break;
+            if (count == 0) waitForWork(drawStatus ? &nextStatus : nullptr);
+        }
+
+        if (statusWidth > 0) {
+            std::fputc('\n', stdout);
+            std::fflush(stdout);
+        }
+    }
+
+    RingBuffer<Message, 4096>  queue;
+    std::atomic<int>           level{static_cast<int>(LogLevel::Info)};
+    std::atomic<bool>          progress{false};
+    std::atomic<bool>          stopping{false};
+    std::atomic<uint64_t>      produced{0}, written{0};
+
+    std::mutex                 wakeMutex;
+    std::condition_variable    wakeUp;
+    bool                       wakeRequested = false; // guarded by wakeMutex
+    std::atomic<bool>          idle{false};           // writer is (about to be) blocked in waitForWork()
+
+    std::atomic<bool>                     started{false};
+    std::atomic<uint64_t>                 total{0}, done{0}, failed{0}, bytes{0};
+    std::chrono::steady_clock::time_point startTime;
+
+    std::thread worker; // last, so it starts after every other member exists
+};
+
+
+/* Shorthands used throughout the tools. */
+template <typename... Args> void logError(const Args&... args)   { Logger::instance().log(LogLevel::Error,   args...); }
+template <typename... Args> void logInfo(const Args&... args)    { Logger::instance().log(LogLevel::Info,    args...); }
+template <typename... Args> void logVerbose(const Args&... args) { Logger::instance().log(LogLevel::Verbose, args...); }
+template <typename... Args> void logFile(const Args&... args)    { Logger::instance().log(Logger::instance().fileLevel(), args...); }
@@ -0,0 +1,109 @@
+/** ================================================================
+| rekey.cpp  --  src/rekey.cpp
+|
+| Created by Jack on 10/18, 2026
+| Copyright © 2024 jacktogon. All rights reserved.
+================================================================= */
+#include "common.hpp"
+
+#include <atomic>
+#include <thread>
+
+/**
+ * Re-wrap the data key of a `.knot` file under `newPassword`, rewriting only
+ * the key block of its header in place. The body is never touched.
+ * @returns `false` if the file already opens with `newPassword` (left over
+ *          from an interrupted run), `true` if it was rekeyed.
+ */
+bool rekeyFile(const std::string& filename, const std::string& oldPassword, const std::string& newPassword) {
+    std::filesystem::path filePath = std::filesystem::absolute(filename);
+
+    std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Unable to open file: " + filePath.string());
+    }
+    KnotHeader header = readHeader(file);
+
+    std::vector<uint8_t> dataKey;
+    KeyGuard wipeKey(dataKey);
+    try {
+        dataKey = unwrapDataKey(header, oldPassword);
+    } catch (const std::runtime_error&) {
+        unwrapDataKey(header, newPassword); // rethrows if neither password opens it
+        return false;
+    }
+
+    wrapDataKey(header, newPassword, dataKey);
+    auto keyBlock = serializeKeyBlock(header);
+
+    file.seekp(KNOT_KEY_BLOCK_OFFSET);
+    file.write(reinterpret_cast<char*>(keyBlock.data()), keyBlock.size());
+    file.close();
+    if (!file) throw std::runtime_error("Error writing to file: " + filePath.string());
+
+    syncFile(filePath);
+    return true;
+}
+
+
+
+int main() {
+    try {
+        if (std::filesystem::exists("config.json")) {
+            configureLogger(parseConfigFile("config.json"));
+        }
+
+        std::vector<std::string> knotFiles = findKnotFiles();
+
+        logInfo("Files to be rekeyed: ", knotFiles.size());
+        for (const auto& file : knotFiles) {
+            logVerbose(file);
+        }
+        if (knotFiles.empty()) {
+            logInfo("No .knot files found.");
+            return 0;
+        }
+
+        std::string oldPassword = getPassword("Current password: ");
+        std::string newPassword = getPassword("New password: ");
+        if (getPassword("Confirm new password: ") != newPassword) {
+            logError("Passwords do not match.");
+            return 1;
+        }
+
+        Logger::instance().startProgress(knotFiles.size());
+
+        // Each file costs two PBKDF2 runs and a tiny write, so spread them
+        // over all cores. No journal is needed to resume: files that already
+        // open with the new password are skipped by rekeyFile().
+        std::atomic<size_t> next{0};
+
+        auto worker = [&]() {
+            for (size_t i = next++; i < knotFiles.size(); i = next++) {
+                const std::string& file = knotFiles[i];
+                try {
+                    bool rekeyed = rekeyFile(file, oldPassword, newPassword);
+                    Logger::instance().fileDone(KNOT_KEY_BLOCK_SIZE);
+                    logFile(rekeyed ? "Successfully rekeyed: " : "Already rekeyed: ", file);
+                } catch (const std::exception& e) {
+                    Logger::instance().fileFailed();
+                    logError("Error rekeying ", file, ": ", e.what());
+                }
+            }
+        };
+
+        unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < threadCount; ++t) {
+            threads.emplace_back(worker);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    } catch (const std::exception& e) {
+        logError("An error occurred: ", e.what());
+        return 1;
+    }
+
+    return 0;
+}
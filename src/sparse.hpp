@@ -0,0 +1,134 @@
+/** ================================================================
+| sparse.hpp  --  src/sparse.hpp
+|
+| Created by Jack on 10/18, 2026
+| Copyright © 2024 jacktogon. All rights reserved.
+================================================================= */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/** A run of bytes that holds data; everything between runs is a hole. */
+struct Extent {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+using Extents = std::vector<Extent>;
+
+/** Logical layout of a (possibly sparse) file. */
+struct SparseMap {
+    uint64_t size = 0;
+    Extents  extents;
+
+    uint64_t dataSize() const {
+        uint64_t total = 0;
+        for (const auto& extent : extents) total += extent.length;
+        return total;
+    }
+};
+
+
+/**
+ * Find the data regions of `path` with `SEEK_DATA` / `SEEK_HOLE`.
+ * @note Where holes cannot be queried (Windows, or a filesystem that rejects
+ *       `SEEK_DATA`) the whole file is reported as a single extent.
+ */
+SparseMap findDataExtents(const std::filesystem::path& path) {
+    SparseMap map;
+    map.size = std::filesystem::file_size(path);
+    Extents dense;
+    if (map.size > 0) dense.push_back({0, map.size});
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Unable to open input file: " + path.string());
+
+    off_t offset = 0;
+    while (static_cast<uint64_t>(offset) < map.size) {
+        off_t data = ::lseek(fd, offset, SEEK_DATA);
+        if (data < 0) {
+            if (errno != ENXIO) map.extents = dense; // holes unsupported here
+            break;                                   // ENXIO: only a hole is left
+        }
+        off_t hole = ::lseek(fd, data, SEEK_HOLE);
+        uint64_t end = hole < 0 ? map.size : std::min<uint64_t>(hole, map.size);
+        if (static_cast<uint64_t>(data) >= end) break;
+
+        map.extents.push_back({static_cast<uint64_t>(data), end - data});
+        offset = static_cast<off_t>(end);
+    }
+    ::close(fd);
+#else
+    map.extents = dense;
+#endif
+    return map;
+}
+
+
+/*
+ * On-disk extent map, stored right after the header (all little-endian):
+ *
+ *   size     8 bytes  logical file size
+ *   count    8 bytes  number of extents
+ *   extents  count x (offset 8 bytes, length 8 bytes)
+ */
+void appendU64(std::vector<uint8_t>& bytes, uint64_t value) {
+    for (int i = 0; i < 8; ++i) bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+uint64_t readU64(std::istream& in) {
+    uint8_t bytes[8];
+    in.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+    if (!in) throw std::runtime_error("Truncated extent map");
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+    return value;
+}
+
+std::vector<uint8_t> serializeSparseMap(const SparseMap& map) {
+    std::vector<uint8_t> bytes;
+    bytes.reserve(16 + 16 * map.extents.size());
+    appendU64(bytes, map.size);
+    appendU64(bytes, map.extents.size());
+    for (const auto& extent : map.extents) {
+        appendU64(bytes, extent.offset);
+        appendU64(bytes, extent.length);
+    }
+    return bytes;
+}
+
+/**
+ * Read and validate an extent map.
+ * @param maxExtents upper bound on the count, so a corrupted map cannot
+ *                   trigger a huge allocation.
+ */
+SparseMap readSparseMap(std::istream& in, uint64_t maxExtents) {
+    SparseMap map;
+    map.size       = readU64(in);
+    uint64_t count = readU64(in);
+    if (count > maxExtents) throw std::runtime_error("Corrupted extent map");
+
+    uint64_t end = 0;
+    map.extents.resize(count);
+    for (auto& extent : map.extents) {
+        extent.offset = readU64(in);
+        extent.length = readU64(in);
+        if (extent.offset < end || extent.length > map.size || extent.offset > map.size - extent.length)
+            throw std::runtime_error("Corrupted extent map");
+        end = extent.offset + extent.length;
+    }
+    return map;
+}